@@ -13,10 +13,13 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <ctype.h>
+#include <time.h>
 
 extern int  errno;
 
@@ -25,11 +28,56 @@ int  errexit(const char *format, ...);
 int  connectTCP(const char *host, const char *service);
 int  passiveTCP(const char *service, int qlen);
 
+/* Prototipos de ftptls.c (FTPS explícito, RFC 4217) */
+int     tls_init(const char *cafile, int verify);
+int     tls_start(int fd, const char *host, int ctrl_fd);
+int     tls_active(int fd);
+ssize_t net_recv(int fd, void *buf, size_t len);
+ssize_t net_send(int fd, const void *buf, size_t len);
+ssize_t net_sendfile(int fd, int in_fd, off_t *offset, size_t count);
+int     net_close(int fd);
+
+/* Prototipos de listado.c (parser de LIST/MLSD en streaming) */
+struct listado;
+struct listado *listado_nuevo(void);
+int     listado_alimentar(struct listado *l, const char *buf, size_t n);
+long    listado_fin(struct listado *l);
+void    listado_ordenar(struct listado *l, int clave, int inverso);
+size_t  listado_imprimir(struct listado *l, const char *patron, FILE *out);
+void    listado_liberar(struct listado *l);
+
+/* Prototipos de cache.c (caché local de descargas) */
+int     cache_abrir(const char *dir, long long limite);
+int     cache_buscar(const char *clave, const char *destino);
+int     cache_guardar(const char *clave, const char *origen);
+void    cache_estadisticas(FILE *out);
+
+/* Prototipos de crlf.c (traducción de fin de línea para TYPE A) */
+size_t  crlf_a_lf(const char *in, size_t n, char *out, int *cr_pend);
+size_t  crlf_fin(char *out, int *cr_pend);
+size_t  lf_a_crlf(const char *in, size_t n, char *out, int *ult_cr);
+
 /* Config */
 #define LINELEN 512
 #define QLEN 5
+#define SEG_DEF 4               /* segmentos por defecto en putpar */
+#define SEG_MAX 16
+#define SEG_MIN (1 << 20)       /* no partir en trozos de menos de 1 MB */
+#define TAIL_MIN 1              /* sondeo de tail -f: de 1 s ... */
+#define TAIL_MAX 30             /* ... hasta 30 s sin crecimiento */
+#define TAIL_CTX 4096           /* bytes previos mostrados al seguir por stdout */
+#define TAIL_N 64               /* seguimientos simultáneos */
+#define FAN_MAX 32              /* destinos de fanput */
 int s_control;
 char g_host[128] = "localhost";
+char g_service[32] = "ftp";
+char g_user[64], g_pass[128];   /* credenciales para abrir sesiones extra */
+int g_tls = 0;      /* -s: AUTH TLS en control y PROT P en datos */
+int g_mlsd = 0;     /* el servidor anuncia MLST en FEAT (RFC 3659) */
+int g_rest = 0;     /* el servidor anuncia REST STREAM en FEAT */
+int g_cache = 0;    /* -C: caché local de descargas activa */
+int g_ascii = 0;    /* TYPE A: traducir LF <-> CRLF en get/put */
+volatile pid_t g_tails[TAIL_N]; /* procesos de tail -f activos (los libera reaper) */
 
 /* ---------------- utilidades de lectura/envío ---------------- */
 
@@ -38,7 +86,7 @@ ssize_t read_line(int fd, char *buf, size_t max) {
     size_t n = 0;
     while (n < max - 1) {
         char c;
-        ssize_t r = recv(fd, &c, 1, 0);
+        ssize_t r = net_recv(fd, &c, 1);
         if (r == 0) { /* EOF */
             if (n == 0) return 0;
             break;
@@ -104,7 +152,7 @@ int send_cmd(int sock, char *out, size_t outsz, const char *fmt, ...) {
     size_t tosend = strlen(cmd);
     size_t sent = 0;
     while (sent < tosend) {
-        ssize_t s = send(sock, cmd + sent, tosend - sent, 0);
+        ssize_t s = net_send(sock, cmd + sent, tosend - sent);
         if (s < 0) {
             if (errno == EINTR) continue;
             perror("send");
@@ -212,10 +260,167 @@ int configurar_port(int *s_listen, char *port_cmd, size_t port_cmd_sz) {
     
     return 0;
 }
+
+/* ---------------- FTPS (AUTH TLS) ---------------- */
+
+/* proteger_control: AUTH TLS y handshake sobre el canal de control (antes del login). */
+int proteger_control(int ctrl_sock, const char *host) {
+    char reply[LINELEN];
+    int code = send_cmd(ctrl_sock, reply, sizeof(reply), "AUTH TLS");
+    if (code < 0) return -1;
+    if (code != 234) {
+        fprintf(stderr, "AUTH TLS rechazado: %s", reply);
+        return -1;
+    }
+    return tls_start(ctrl_sock, host, -1);
+}
+
+/* proteger_datos: PBSZ 0 + PROT P para cifrar también los canales de datos. */
+int proteger_datos(int ctrl_sock) {
+    char reply[LINELEN];
+    int code = send_cmd(ctrl_sock, reply, sizeof(reply), "PBSZ 0");
+    if (code / 100 != 2) {
+        fprintf(stderr, "PBSZ falló: %s", code < 0 ? "\n" : reply);
+        return -1;
+    }
+    code = send_cmd(ctrl_sock, reply, sizeof(reply), "PROT P");
+    if (code / 100 != 2) {
+        fprintf(stderr, "PROT P falló: %s", code < 0 ? "\n" : reply);
+        return -1;
+    }
+    return 0;
+}
+
+/* datos_tls: handshake en la conexión de datos tras el 1xx, reanudando la sesión
+ * del control. No hace nada si el control va en claro. */
+int datos_tls(int sdata, int ctrl_sock) {
+    if (!tls_active(ctrl_sock)) return 0;
+    return tls_start(sdata, g_host, ctrl_sock);
+}
+
+/* enviar_todo: net_send hasta agotar el buffer. */
+int enviar_todo(int sdata, const char *p, size_t n) {
+    size_t sent = 0;
+    while (sent < n) {
+        ssize_t w = net_send(sdata, p + sent, n - sent);
+        if (w < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            perror("send data");
+            return -1;
+        }
+        sent += w;
+    }
+    return 0;
+}
+
+/* enviar_archivo: envía len bytes de fd desde off (len < 0: hasta EOF) por el socket
+ * de datos. Usa sendfile (también con kTLS) y cae a read/send cuando el kernel o la
+ * sesión TLS no lo permiten. En modo ASCII siempre read/send, traduciendo LF a CRLF. */
+int enviar_archivo(int sdata, int fd, off_t off, off_t len) {
+    char buf[8192], conv[2 * sizeof(buf)];
+    off_t fin = len < 0 ? -1 : off + len;
+    int ult_cr = 0;
+    ssize_t r;
+
+    while (!g_ascii) {
+        size_t pedir = 1 << 20;
+        if (fin >= 0 && (off_t)pedir > fin - off) pedir = fin - off;
+        if (pedir == 0) return 0;
+        r = net_sendfile(sdata, fd, &off, pedir);
+        if (r > 0) continue;
+        if (r == 0) return fin < 0 ? 0 : -1;
+        if (errno == EINTR || errno == EAGAIN) continue;
+        if (errno == ENOTSUP || errno == EINVAL || errno == ENOSYS) break;
+        perror("sendfile");
+        return -1;
+    }
+
+    if (lseek(fd, off, SEEK_SET) < 0) {
+        perror("lseek");
+        return -1;
+    }
+    for (;;) {
+        size_t pedir = sizeof(buf);
+        if (fin >= 0 && (off_t)pedir > fin - off) pedir = fin - off;
+        if (pedir == 0) break;
+        if ((r = read(fd, buf, pedir)) == 0) break;
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            return -1;
+        }
+        if (g_ascii) {
+            size_t k = lf_a_crlf(buf, (size_t)r, conv, &ult_cr);
+            if (enviar_todo(sdata, conv, k) < 0) return -1;
+        } else if (enviar_todo(sdata, buf, (size_t)r) < 0) {
+            return -1;
+        }
+        off += r;
+    }
+    return (fin >= 0 && off < fin) ? -1 : 0;
+}
+
+/* ---------------- FEAT y listados ---------------- */
+
+/* detectar_feat: FEAT tras el login; anota las extensiones RFC 3659 que usamos. */
+void detectar_feat(int ctrl_sock) {
+    char feat[4096];
+    if (send_cmd(ctrl_sock, feat, sizeof(feat), "FEAT") / 100 != 2) return;
+    g_mlsd = strstr(feat, " MLST") != NULL;
+    g_rest = strstr(feat, " REST STREAM") != NULL;
+}
+
+/* listar: MLSD (o LIST si no hay MLST) pasando cada trozo al parser en streaming;
+ * luego ordena e imprime las entradas que casan con el patrón. */
+int listar(int ctrl_sock, const char *patron, int clave, int inverso) {
+    static char buf[65536];
+    char reply[LINELEN];
+    ssize_t n;
+    int fallo = 0;
+
+    int sdata = pasivo_conn(ctrl_sock);
+    if (sdata < 0) { fprintf(stderr, "No se pudo abrir PASV\n"); return -1; }
+    if (send_cmd(ctrl_sock, reply, sizeof(reply), g_mlsd ? "MLSD" : "LIST") < 0) {
+        close(sdata);
+        return -1;
+    }
+    if (reply[0] != '1') { printf("%s", reply); close(sdata); return -1; }
+    if (datos_tls(sdata, ctrl_sock) < 0) {
+        close(sdata);
+        expect_reply(ctrl_sock, reply, sizeof(reply));
+        return -1;
+    }
+
+    struct listado *l = listado_nuevo();
+    while ((n = net_recv(sdata, buf, sizeof(buf))) > 0) {
+        if (l == NULL || listado_alimentar(l, buf, (size_t)n) < 0) { fallo = 1; break; }
+    }
+    if (n < 0) perror("ls: listado incompleto");
+    net_close(sdata);
+    if (expect_reply(ctrl_sock, reply, sizeof(reply)) >= 0 && reply[0] != '2') printf("%s", reply);
+
+    if (fallo || listado_fin(l) < 0) {
+        fprintf(stderr, "ls: sin memoria para el listado\n");
+        listado_liberar(l);
+        return -1;
+    }
+    listado_ordenar(l, clave, inverso);
+    listado_imprimir(l, patron, stdout);
+    listado_liberar(l);
+    return 0;
+}
+
 /* ---------------- manejo de Señales ---------------- */
 void reaper(int sig) {
+    pid_t pid;
+    int i;
     (void)sig;
-    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        /* un tail -f que termina solo libera su hueco: untail/quit no deben
+         * mandar SIGTERM a un PID que el sistema ya puede haber reutilizado */
+        for (i = 0; i < TAIL_N; i++)
+            if (g_tails[i] == pid) g_tails[i] = 0;
+    }
 }
 
 /* ---------------- Ayuda ---------------- */
@@ -223,13 +428,20 @@ void ayuda() {
     printf("Cliente FTP Concurrente. Comandos:\n"
            " help           - muestra esta ayuda\n"
            " dir            - LIST (modo PASV)\n"
+           " ls [-s|-t] [-r] [patron] - listado parseado (MLSD/LIST), ordenado y filtrado\n"
            " get <archivo>  - RETR en PASV (concurrente)\n"
            " put <archivo>  - STOR en PASV (concurrente)\n"
            " pput <archivo> - STOR en PORT (modo activo, concurrente)\n"
+           " putpar <archivo> [n] - STOR en n segmentos paralelos (REST + STOR)\n"
+           " ascii / binary - TYPE A (traduce CRLF <-> LF) / TYPE I\n"
            " cd <dir>       - CWD\n"
            " pwd            - PWD (extra)\n"
            " mkd <dir>      - MKD (extra)\n"
            " dele <file>    - DELE (extra)\n"
+           " fanput [-t seg] <archivo> host[:puerto] ... - STOR a varios espejos leyendo el archivo una vez\n"
+           " tail -f <remoto> [local] - sigue un archivo remoto que crece (REST + RETR)\n"
+           " untail [pid]   - detiene uno o todos los tail -f\n"
+           " cache          - estadísticas de la caché de descargas (-C)\n"
            " quit           - QUIT\n");
 }
 
@@ -262,21 +474,642 @@ char* read_password(const char *prompt) {
     return password;
 }
 
+/* ---------------- Transferencias ---------------- */
+
+/* ruta_remota: resuelve arg contra el PWD de ctrl_sock, para usarlo desde sesiones
+ * nuevas, que empiezan en el directorio de login. Devuelve 0 o -1. */
+int ruta_remota(int ctrl_sock, const char *arg, char *ruta, size_t n) {
+    char reply[LINELEN];
+
+    if (arg[0] == '/') {
+        snprintf(ruta, n, "%s", arg);
+        return 0;
+    }
+    if (send_cmd(ctrl_sock, reply, sizeof(reply), "PWD") != 257) return -1;
+    char *a = strchr(reply, '"');
+    char *b = a ? strrchr(a + 1, '"') : NULL;
+    if (!b) return -1;
+    int len = (int)(b - a - 1);
+    snprintf(ruta, n, "%.*s%s%s", len, a + 1, len > 0 && a[len] == '/' ? "" : "/", arg);
+    return 0;
+}
+
+/* clave_cache: identifica la versión remota de un archivo (host, ruta absoluta, SIZE
+ * y MDTM). Devuelve 0 y rellena clave y *tam, o -1 si no se puede cachear. */
+int clave_cache(int ctrl_sock, const char *arg, char *clave, size_t n, long long *tam) {
+    char reply[LINELEN], ruta[LINELEN], mdtm[32];
+
+    if (send_cmd(ctrl_sock, reply, sizeof(reply), "SIZE %s", arg) != 213 ||
+        sscanf(reply + 4, "%lld", tam) != 1) return -1;
+    if (send_cmd(ctrl_sock, reply, sizeof(reply), "MDTM %s", arg) != 213 ||
+        sscanf(reply + 4, "%31s", mdtm) != 1) return -1;
+    if (ruta_remota(ctrl_sock, arg, ruta, sizeof(ruta)) < 0) return -1;
+    snprintf(clave, n, "%s:%s|%s|%lld|%s", g_host, g_service, ruta, *tam, mdtm);
+    return 0;
+}
+
+/* subir: STOR en PASV de un único flujo; el hijo envía los datos y el padre
+ * espera el 226 en el control. */
+int subir(int ctrl_sock, const char *arg) {
+    char reply[LINELEN];
+    int sdata;
+    pid_t pid;
+
+    if (access(arg, R_OK) < 0) { perror("Open local file"); return -1; }
+
+    sdata = pasivo_conn(ctrl_sock);
+    if (sdata < 0) return -1;
+
+    if (send_cmd(ctrl_sock, reply, sizeof(reply), "STOR %s", arg) < 0) {
+        close(sdata);
+        return -1;
+    }
+
+    if (reply[0] != '1') {
+        printf("%s", reply);
+        close(sdata);
+        return -1;
+    }
+
+    fflush(stdout);  /* que el hijo no herede salida pendiente */
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(sdata);
+        return -1;
+    }
+
+    if (pid == 0) {
+        if (datos_tls(sdata, ctrl_sock) < 0) {
+            close(sdata);
+            exit(1);
+        }
+        int fd_child = open(arg, O_RDONLY);
+        if (fd_child < 0) {
+            perror("open child");
+            net_close(sdata);
+            exit(1);
+        }
+
+        int rc = enviar_archivo(sdata, fd_child, 0, -1);
+
+        close(fd_child);
+        net_close(sdata);
+        exit(rc < 0 ? 1 : 0);
+    }
+
+    close(sdata);
+    printf("Transferencia PUT iniciada (PID %d)\n", pid);
+
+    if (expect_reply(ctrl_sock, reply, sizeof(reply)) >= 0) {
+        printf("%s", reply);
+    }
+    return 0;
+}
+
+/* abrir_sesion: nueva conexión de control ya autenticada (TLS si -s, TYPE I) con
+ * las credenciales del login interactivo. Devuelve el socket o -1. */
+int abrir_sesion(const char *host, const char *service) {
+    char reply[LINELEN];
+    int code;
+    int s = connectTCP(host, service);
+    if (s < 0) return -1;
+
+    if (expect_reply(s, reply, sizeof(reply)) / 100 != 2) goto fallo;
+    if (g_tls && proteger_control(s, host) < 0) goto fallo;
+    code = send_cmd(s, reply, sizeof(reply), "USER %s", g_user);
+    if (code == 331) code = send_cmd(s, reply, sizeof(reply), "PASS %s", g_pass);
+    if (code != 230) {
+        fprintf(stderr, "%s: login rechazado: %s", host, code < 0 ? "\n" : reply);
+        goto fallo;
+    }
+    if (g_tls && proteger_datos(s) < 0) goto fallo;
+    if (send_cmd(s, reply, sizeof(reply), "TYPE I") / 100 != 2) goto fallo;
+    return s;
+
+fallo:
+    net_close(s);
+    return -1;
+}
+
+/* cerrar_sesion: QUIT y cierre de una sesión abierta con abrir_sesion. */
+void cerrar_sesion(int ctrl_sock) {
+    char reply[LINELEN];
+    send_cmd(ctrl_sock, reply, sizeof(reply), "QUIT");
+    net_close(ctrl_sock);
+}
+
+/* subida_unica: STOR del archivo entero por una sesión ya abierta, esperando el
+ * final en el propio proceso. Devuelve 0 o -1. */
+static int subida_unica(int ctrl_sock, const char *arg, const char *remoto) {
+    char reply[LINELEN];
+    int fd, rc;
+    int sdata = pasivo_conn(ctrl_sock);
+    if (sdata < 0) return -1;
+
+    if (send_cmd(ctrl_sock, reply, sizeof(reply), "STOR %s", remoto) < 0 || reply[0] != '1') {
+        fprintf(stderr, "putpar: STOR: %s", reply);
+        close(sdata);
+        return -1;
+    }
+    if (datos_tls(sdata, ctrl_sock) < 0 || (fd = open(arg, O_RDONLY)) < 0) {
+        net_close(sdata);
+        expect_reply(ctrl_sock, reply, sizeof(reply));
+        return -1;
+    }
+    rc = enviar_archivo(sdata, fd, 0, -1);
+    close(fd);
+    net_close(sdata);
+    if (expect_reply(ctrl_sock, reply, sizeof(reply)) / 100 != 2) {
+        fprintf(stderr, "putpar: %s", reply);
+        return -1;
+    }
+    return rc < 0 ? -1 : 0;
+}
+
+/* subida_segmentada: cuerpo del proceso coordinador de putpar. Abre una sesión por
+ * segmento, lanza REST+STOR en orden (el segmento 0 trunca el archivo antes de que
+ * los demás escriban), envía cada rango desde su propio hijo y verifica con SIZE. */
+static int subida_segmentada(const char *arg, const char *remoto, off_t tam, int nseg) {
+    char reply[LINELEN];
+    int ctrl[SEG_MAX], data[SEG_MAX];
+    pid_t hijos[SEG_MAX];
+    off_t trozo = (tam + nseg - 1) / nseg;
+    int i, nhijos, ok = 1;
+    int montados = 0;       /* segmentos con el STOR ya aceptado (1xx) */
+    int unico = 0;          /* se recurrió a un solo flujo por ctrl[0] */
+
+    for (i = 0; i < nseg; i++) ctrl[i] = data[i] = -1;
+    for (i = 0; i < nseg; i++) {
+        if ((ctrl[i] = abrir_sesion(g_host, g_service)) < 0) { ok = 0; break; }
+    }
+
+    for (i = 0; ok && i < nseg; i++) {
+        off_t off = (off_t)i * trozo;
+        if ((data[i] = pasivo_conn(ctrl[i])) < 0) { ok = 0; break; }
+        if (off > 0 && send_cmd(ctrl[i], reply, sizeof(reply), "REST %lld",
+                                (long long)off) != 350) {
+            fprintf(stderr, "putpar: REST %lld rechazado: %s", (long long)off, reply);
+            ok = 0;
+            break;
+        }
+        if (send_cmd(ctrl[i], reply, sizeof(reply), "STOR %s", remoto) < 0 || reply[0] != '1') {
+            fprintf(stderr, "putpar: STOR segmento %d: %s", i, reply);
+            ok = 0;
+            break;
+        }
+        montados = i + 1;
+    }
+
+    if (!ok && ctrl[0] >= 0) {
+        /* servidor que acepta REST pero no REST+STOR (p. ej. ProFTPD sin
+         * AllowStoreRestart) o que no admite más sesiones: el STOR del segmento 0
+         * puede haber truncado ya el archivo remoto, así que no se abandona; se
+         * cierran los segmentos montados sin datos y se sube entero por ctrl[0] */
+        for (i = 0; i < nseg; i++) {
+            if (data[i] >= 0) { close(data[i]); data[i] = -1; }
+        }
+        for (i = 0; i < montados; i++) expect_reply(ctrl[i], reply, sizeof(reply));
+        printf("putpar: el servidor no admite la subida segmentada, subida en un solo flujo\n");
+        unico = 1;
+        ok = subida_unica(ctrl[0], arg, remoto) == 0;
+    }
+
+    for (i = 0; ok && !unico && i < nseg; i++) {
+        off_t off = (off_t)i * trozo;
+        off_t len = tam - off < trozo ? tam - off : trozo;
+        fflush(stdout);
+        hijos[i] = fork();
+        if (hijos[i] < 0) { perror("fork"); ok = 0; break; }
+        if (hijos[i] == 0) {
+            int fd = open(arg, O_RDONLY);
+            if (fd < 0 || datos_tls(data[i], ctrl[i]) < 0) exit(1);
+            int rc = enviar_archivo(data[i], fd, off, len);
+            net_close(data[i]);
+            exit(rc < 0 ? 1 : 0);
+        }
+        close(data[i]);
+        data[i] = -1;
+    }
+    nhijos = i;
+
+    for (i = 0; i < nhijos; i++) {
+        int st;
+        if (waitpid(hijos[i], &st, 0) < 0 || !WIFEXITED(st) || WEXITSTATUS(st) != 0) ok = 0;
+        if (expect_reply(ctrl[i], reply, sizeof(reply)) / 100 != 2) {
+            fprintf(stderr, "putpar: segmento %d: %s", i, reply);
+            ok = 0;
+        }
+    }
+
+    if (ok) {
+        long long rtam = -1;
+        if (send_cmd(ctrl[0], reply, sizeof(reply), "SIZE %s", remoto) == 213)
+            sscanf(reply + 4, "%lld", &rtam);
+        if (rtam != (long long)tam) {
+            fprintf(stderr, "putpar: SIZE remoto %lld != local %lld\n", rtam, (long long)tam);
+            ok = 0;
+        }
+    }
+
+    for (i = 0; i < nseg; i++) {
+        if (data[i] >= 0) close(data[i]);
+        if (ctrl[i] >= 0) cerrar_sesion(ctrl[i]);
+    }
+    printf("putpar %s: %s (%lld bytes, %d segmentos)\n", arg,
+           ok ? "completado y verificado con SIZE" : "FALLÓ", (long long)tam, unico ? 1 : nseg);
+    return ok ? 0 : -1;
+}
+
+/* subir_paralelo: putpar. Reparte el archivo en rangos subidos cada uno por su propia
+ * sesión con REST+STOR; si el servidor no soporta REST o el archivo es pequeño, usa
+ * el put normal de un solo flujo. */
+int subir_paralelo(int ctrl_sock, const char *arg, int nseg) {
+    char reply[LINELEN], remoto[LINELEN];
+    struct stat st;
+    pid_t pid;
+
+    if (stat(arg, &st) < 0) { perror("Open local file"); return -1; }
+    if (nseg > SEG_MAX) nseg = SEG_MAX;
+    if (nseg > st.st_size / SEG_MIN) nseg = (int)(st.st_size / SEG_MIN);
+
+    if (g_ascii) {
+        /* en TYPE A los offsets locales y remotos no coinciden */
+        printf("putpar: modo ASCII, subida en un solo flujo\n");
+        return subir(ctrl_sock, arg);
+    }
+    if (nseg < 2 || !g_rest ||
+        send_cmd(ctrl_sock, reply, sizeof(reply), "REST 0") != 350) {
+        printf("putpar: sin REST o archivo pequeño, subida en un solo flujo\n");
+        return subir(ctrl_sock, arg);
+    }
+    /* las sesiones de los segmentos no heredan el cd de esta */
+    if (ruta_remota(ctrl_sock, arg, remoto, sizeof(remoto)) < 0) {
+        fprintf(stderr, "putpar: no se pudo obtener el directorio remoto (PWD)\n");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) { perror("fork"); return -1; }
+    if (pid == 0) {
+        /* el coordinador espera a sus propios hijos: sin el reaper heredado */
+        signal(SIGCHLD, SIG_DFL);
+        exit(subida_segmentada(arg, remoto, st.st_size, nseg) < 0 ? 1 : 0);
+    }
+    printf("Transferencia PUTPAR iniciada (PID %d, %d segmentos)\n", pid, nseg);
+    return 0;
+}
+
+/* traer_desde: REST off + RETR, añade lo recibido a out. Devuelve los bytes que se
+ * llegaron a escribir en out aunque la transferencia falle (426/451, error de write),
+ * para que el llamante avance el offset sin repetirlos; el fallo va en *fallo. */
+static long long traer_desde(int ctrl_sock, const char *remoto, long long off, int out,
+                             int *fallo) {
+    char reply[LINELEN], buf[8192];
+    long long total = 0;
+    ssize_t n;
+
+    *fallo = 1;
+    int sdata = pasivo_conn(ctrl_sock);
+    if (sdata < 0) return 0;
+    if (send_cmd(ctrl_sock, reply, sizeof(reply), "REST %lld", off) != 350 ||
+        send_cmd(ctrl_sock, reply, sizeof(reply), "RETR %s", remoto) < 0 || reply[0] != '1') {
+        fprintf(stderr, "tail %s: %s", remoto, reply);
+        close(sdata);
+        return 0;
+    }
+    if (datos_tls(sdata, ctrl_sock) < 0) {
+        close(sdata);
+        expect_reply(ctrl_sock, reply, sizeof(reply));
+        return 0;
+    }
+    while ((n = net_recv(sdata, buf, sizeof(buf))) > 0) {
+        ssize_t w = 0;
+        while (w < n) {
+            ssize_t k = write(out, buf + w, n - w);
+            if (k < 0) {
+                if (errno == EINTR) continue;
+                perror("tail: write");
+                net_close(sdata);
+                expect_reply(ctrl_sock, reply, sizeof(reply));
+                return total + w;
+            }
+            w += k;
+        }
+        total += n;
+    }
+    net_close(sdata);
+    if (expect_reply(ctrl_sock, reply, sizeof(reply)) / 100 != 2) {
+        fprintf(stderr, "tail %s: %s", remoto, reply);
+        return total;
+    }
+    *fallo = 0;
+    return total;
+}
+
+/* seguir: cuerpo del proceso de tail -f. Sesión de control propia y persistente;
+ * sondea SIZE y trae solo los bytes nuevos con REST+RETR. El intervalo se duplica
+ * mientras el archivo no crece (hasta TAIL_MAX) y vuelve a TAIL_MIN al crecer. */
+static void seguir(const char *remoto, const char *local) {
+    char reply[LINELEN];
+    long long off = -1, tam;
+    int espera = TAIL_MIN;
+    int out = STDOUT_FILENO;
+    int ctrl = -1;
+
+    if (local) {
+        struct stat st;
+        if ((out = open(local, O_WRONLY | O_CREAT | O_APPEND, 0644)) < 0) {
+            perror(local);
+            exit(1);
+        }
+        off = fstat(out, &st) == 0 ? (long long)st.st_size : 0; /* continuar donde quedó */
+    }
+
+    for (;;) {
+        if (ctrl < 0 && (ctrl = abrir_sesion(g_host, g_service)) < 0) {
+            sleep(TAIL_MAX);
+            continue;
+        }
+        int code = send_cmd(ctrl, reply, sizeof(reply), "SIZE %s", remoto);
+        if (code < 0) {                     /* control caído: reconectar */
+            net_close(ctrl);
+            ctrl = -1;
+            continue;
+        }
+        if (code != 213 || sscanf(reply + 4, "%lld", &tam) != 1) {
+            /* p. ej. aún no existe: sin tamaño no hay truncado ni bytes nuevos */
+            fprintf(stderr, "tail %s: %s", remoto, reply);
+            tam = -1;
+        } else {
+            if (off < 0) off = tam > TAIL_CTX ? tam - TAIL_CTX : 0;
+            if (tam < off) {
+                fprintf(stderr, "tail %s: archivo truncado, siguiendo desde el principio\n", remoto);
+                off = 0;
+            }
+        }
+        int fallo = 1;      /* sin crecimiento cuenta como fallo: se espacia el sondeo */
+        if (tam >= 0 && tam > off) {
+            /* off avanza también con lo escrito antes de un fallo: el reintento
+             * pide solo lo que falta */
+            off += traer_desde(ctrl, remoto, off, out, &fallo);
+        }
+        if (!fallo) {
+            espera = TAIL_MIN;
+        } else if (espera < TAIL_MAX) {
+            espera = espera * 2 > TAIL_MAX ? TAIL_MAX : espera * 2;
+        }
+        sleep(espera);
+    }
+}
+
+/* seguir_remoto: tail -f. Lanza un proceso seguidor y lo anota para untail/quit. */
+int seguir_remoto(int ctrl_sock, const char *arg, const char *local) {
+    char remoto[LINELEN];
+    sigset_t chld, prev;
+    int i;
+    pid_t pid;
+
+    if (!g_rest) {
+        printf("tail -f: el servidor no anuncia REST STREAM\n");
+        return -1;
+    }
+    for (i = 0; i < TAIL_N && g_tails[i] > 0; i++) {}
+    if (i == TAIL_N) {
+        printf("tail -f: demasiados seguimientos activos\n");
+        return -1;
+    }
+    /* la sesión del seguidor empieza en el directorio de login, no en el del cd */
+    if (ruta_remota(ctrl_sock, arg, remoto, sizeof(remoto)) < 0) {
+        printf("tail -f: no se pudo obtener el directorio remoto (PWD)\n");
+        return -1;
+    }
+    /* SIGCHLD bloqueada hasta anotar el PID: si el hijo muere antes, reaper
+     * lo encuentra ya en g_tails */
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &prev);
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        return -1;
+    }
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+        seguir(remoto, local);
+        exit(0);
+    }
+    g_tails[i] = pid;
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    printf("Siguiendo %s -> %s (PID %d, untail %d para parar)\n",
+           remoto, local ? local : "stdout", pid, pid);
+    return 0;
+}
+
+/* dejar_de_seguir: untail [pid]; sin pid detiene todos los seguimientos. */
+void dejar_de_seguir(pid_t pid) {
+    int i;
+    for (i = 0; i < TAIL_N; i++) {
+        if (g_tails[i] > 0 && (pid == 0 || g_tails[i] == pid)) {
+            kill(g_tails[i], SIGTERM);
+            g_tails[i] = 0;
+        }
+    }
+}
+
+/* fan_destino: cuerpo del hijo de fanput para un destino. Cada hijo envía desde el
+ * mismo mmap del archivo, así que el disco se lee una sola vez y un espejo lento solo
+ * se frena a sí mismo (backpressure de su propio socket). */
+static int fan_destino(const char *destino, const char *arg, const char *map, off_t tam) {
+    char reply[LINELEN], service[32];
+    const char *dp = strchr(destino, ':');
+    off_t off = 0;
+
+    /* este proceso solo habla con su destino: g_host/g_service pasan a ser los suyos */
+    snprintf(g_host, sizeof(g_host), "%.*s", dp ? (int)(dp - destino) : (int)strlen(destino), destino);
+    snprintf(service, sizeof(service), "%s", dp ? dp + 1 : g_service);
+
+    int ctrl = abrir_sesion(g_host, service);
+    if (ctrl < 0) return -1;
+    if (g_ascii && send_cmd(ctrl, reply, sizeof(reply), "TYPE A") / 100 != 2) {
+        cerrar_sesion(ctrl);
+        return -1;
+    }
+    int sdata = pasivo_conn(ctrl);
+    if (sdata < 0) { cerrar_sesion(ctrl); return -1; }
+    if (send_cmd(ctrl, reply, sizeof(reply), "STOR %s", arg) < 0 || reply[0] != '1') {
+        fprintf(stderr, "fanput %s: %s", destino, reply);
+        close(sdata);
+        cerrar_sesion(ctrl);
+        return -1;
+    }
+    if (datos_tls(sdata, ctrl) < 0) {
+        close(sdata);
+        cerrar_sesion(ctrl);
+        return -1;
+    }
+    static char conv[2 * 65536];
+    int ult_cr = 0;
+    while (off < tam) {
+        size_t pedir = tam - off > 65536 ? 65536 : (size_t)(tam - off);
+        int rc = g_ascii ? enviar_todo(sdata, conv, lf_a_crlf(map + off, pedir, conv, &ult_cr))
+                         : enviar_todo(sdata, map + off, pedir);
+        if (rc < 0) break;
+        off += pedir;
+    }
+    net_close(sdata);
+    int code = expect_reply(ctrl, reply, sizeof(reply));
+    cerrar_sesion(ctrl);
+    return (off == tam && code / 100 == 2) ? 0 : -1;
+}
+
+static void nada(int sig) { (void)sig; }
+
+/* subida_abanico: coordinador de fanput. Mapea el archivo una vez, lanza un hijo por
+ * destino y espera. Con corte > 0, cuando completa el primer destino los demás tienen
+ * corte segundos más; los que sigan entonces se cortan como rezagados. */
+static int subida_abanico(const char *arg, char **destinos, int n, int corte) {
+    pid_t hijos[FAN_MAX];
+    int estado[FAN_MAX];    /* 0 en curso, 1 ok, -1 fallo, -2 cortado */
+    int i, vivos = 0, fallos = 0;
+    struct stat st;
+    char *map = NULL;
+    sigset_t chld;
+    struct timespec plazo = {0, 0}, resto, *presto = NULL;  /* plazo: CLOCK_MONOTONIC */
+
+    int fd = open(arg, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) { perror(arg); return -1; }
+    if (st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) { perror("mmap"); close(fd); return -1; }
+        posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    signal(SIGCHLD, nada);
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+
+    for (i = 0; i < n; i++) {
+        estado[i] = 0;
+        fflush(stdout);
+        hijos[i] = fork();
+        if (hijos[i] < 0) { perror("fork"); estado[i] = -1; continue; }
+        if (hijos[i] == 0) {
+            sigprocmask(SIG_UNBLOCK, &chld, NULL);
+            exit(fan_destino(destinos[i], arg, map, st.st_size) < 0 ? 1 : 0);
+        }
+        vivos++;
+    }
+
+    while (vivos > 0) {
+        int stw;
+        pid_t p;
+        while ((p = waitpid(-1, &stw, WNOHANG)) > 0) {
+            for (i = 0; i < n && hijos[i] != p; i++) {}
+            if (i == n) continue;
+            if (estado[i] == 0)
+                estado[i] = (WIFEXITED(stw) && WEXITSTATUS(stw) == 0) ? 1 : -1;
+            vivos--;
+            if (corte > 0 && plazo.tv_sec == 0 && estado[i] == 1) {
+                clock_gettime(CLOCK_MONOTONIC, &plazo);
+                plazo.tv_sec += corte;
+                printf("fanput: primer destino terminado, %d s para el resto\n", corte);
+            }
+        }
+        if (vivos == 0) break;
+        /* sigtimedwait espera un tiempo relativo: pasar lo que queda del plazo,
+         * no corte entero, para que cada SIGCHLD no reinicie la ventana */
+        if (plazo.tv_sec != 0) {
+            struct timespec ahora;
+            clock_gettime(CLOCK_MONOTONIC, &ahora);
+            resto.tv_sec = plazo.tv_sec - ahora.tv_sec;
+            resto.tv_nsec = plazo.tv_nsec - ahora.tv_nsec;
+            if (resto.tv_nsec < 0) { resto.tv_sec--; resto.tv_nsec += 1000000000L; }
+            if (resto.tv_sec < 0) resto.tv_sec = resto.tv_nsec = 0;
+            presto = &resto;
+        }
+        if (sigtimedwait(&chld, NULL, presto) < 0 && errno == EAGAIN) {
+            for (i = 0; i < n; i++) {
+                if (estado[i] == 0) {
+                    kill(hijos[i], SIGTERM);
+                    estado[i] = -2;
+                }
+            }
+            plazo.tv_sec = 0;
+            presto = NULL;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        printf("fanput %s -> %s: %s\n", arg, destinos[i],
+               estado[i] == 1 ? "completado" : estado[i] == -2 ? "cortado (rezagado)" : "FALLÓ");
+        if (estado[i] != 1) fallos++;
+    }
+    if (map) munmap(map, st.st_size);
+    return fallos ? -1 : 0;
+}
+
+/* subir_abanico: fanput [-t seg] <archivo> host[:puerto] ... en segundo plano. */
+int subir_abanico(const char *arg, char **destinos, int n, int corte) {
+    pid_t pid;
+
+    if (access(arg, R_OK) < 0) { perror("Open local file"); return -1; }
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) { perror("fork"); return -1; }
+    if (pid == 0) exit(subida_abanico(arg, destinos, n, corte) < 0 ? 1 : 0);
+    printf("Transferencia FANPUT iniciada (PID %d, %d destinos)\n", pid, n);
+    return 0;
+}
+
 /* ---------------- Main ---------------- */
 int main(int argc, char *argv[]) {
     char reply[LINELEN], data_buf[LINELEN];
-    char prompt[256];
+    char prompt[2048];      /* cabe fanput con FAN_MAX destinos host:puerto */
     char user[64];
     char *arg;
     int sdata, n;
     FILE *fp;
     pid_t pid;
+    const char *cafile = NULL;
+    int verify = 1, opt;
 
-    if (argc >= 2) {
-        strncpy(g_host, argv[1], sizeof(g_host)-1);
+    const char *cachedir = NULL;
+    long long cache_mb = 1024;
+
+    while ((opt = getopt(argc, argv, "sc:kC:M:")) != -1) {
+        switch (opt) {
+        case 's': g_tls = 1; break;
+        case 'c': cafile = optarg; break;
+        case 'k': verify = 0; break;
+        case 'C': cachedir = optarg; break;
+        case 'M': cache_mb = atoll(optarg); break;
+        default:
+            errexit("Uso: %s [-s] [-c ca.pem] [-k] [-C cachedir] [-M MB] <host> [puerto]\n", argv[0]);
+        }
+    }
+    if (cachedir) {
+        if (cache_mb <= 0 || cache_abrir(cachedir, cache_mb << 20) < 0)
+            fprintf(stderr, "Aviso: caché %s desactivada: %s\n", cachedir, strerror(errno));
+        else
+            g_cache = 1;
+    }
+    if (optind < argc) {
+        strncpy(g_host, argv[optind], sizeof(g_host)-1);
         g_host[sizeof(g_host)-1] = '\0';
     }
-    const char *service = (argc >= 3) ? argv[2] : "ftp";
+    if (optind + 1 < argc) {
+        strncpy(g_service, argv[optind + 1], sizeof(g_service)-1);
+        g_service[sizeof(g_service)-1] = '\0';
+    }
+    const char *service = g_service;
+
+    if (g_tls && tls_init(cafile, verify) < 0) errexit("No se pudo inicializar TLS\n");
 
     struct sigaction sa;
     sa.sa_handler = reaper;
@@ -285,6 +1118,10 @@ int main(int argc, char *argv[]) {
     if (sigaction(SIGCHLD, &sa, NULL) == -1) {
         perror("sigaction");
     }
+    /* un servidor que corta la conexión no debe matar al cliente con SIGPIPE */
+    sa.sa_handler = SIG_IGN;
+    sa.sa_flags = 0;
+    sigaction(SIGPIPE, &sa, NULL);
 
     s_control = connectTCP(g_host, service);
     if (s_control < 0) errexit("No pudo conectar a %s:%s\n", g_host, service);
@@ -295,6 +1132,11 @@ int main(int argc, char *argv[]) {
     }
     printf("%s", reply);
 
+    if (g_tls && proteger_control(s_control, g_host) < 0) {
+        close(s_control);
+        errexit("No se pudo establecer TLS en el canal de control\n");
+    }
+
     /* login interactivo */
     while (1) {
         printf("Please enter your username: ");
@@ -309,7 +1151,16 @@ int main(int argc, char *argv[]) {
         if (code < 0) { close(s_control); errexit("Error en PASS\n"); }
         printf("%s", reply);
 
-        if (code == 230) break; /* login correcto */
+        if (code == 230) { /* login correcto */
+            strcpy(g_user, user);
+            strncpy(g_pass, pass ? pass : "", sizeof(g_pass)-1);
+            break;
+        }
+    }
+
+    if (g_tls && proteger_datos(s_control) < 0) {
+        net_close(s_control);
+        errexit("El servidor no acepta canales de datos cifrados\n");
     }
 
     /* asegurar modo binario para transferencias */
@@ -319,6 +1170,7 @@ int main(int argc, char *argv[]) {
         /* show result */
         // printf("%s", reply);
     }
+    detectar_feat(s_control);
 
     ayuda();
 
@@ -326,6 +1178,13 @@ int main(int argc, char *argv[]) {
     while (1) {
         printf("ftp> ");
         if (fgets(prompt, sizeof(prompt), stdin) == NULL) break;
+        if (strchr(prompt, '\n') == NULL && !feof(stdin)) {
+            /* no ejecutar un comando cortado (p. ej. fanput sin sus últimos destinos) */
+            int c;
+            while ((c = getchar()) != '\n' && c != EOF) {}
+            printf("Línea demasiado larga (máximo %zu caracteres)\n", sizeof(prompt) - 2);
+            continue;
+        }
         prompt[strcspn(prompt, "\r\n")] = '\0';
         if (prompt[0] == '\0') continue;
 
@@ -348,19 +1207,96 @@ int main(int argc, char *argv[]) {
             sdata = pasivo_conn(s_control);
             if (sdata < 0) { fprintf(stderr, "No se pudo abrir PASV\n"); continue; }
             if (send_cmd(s_control, reply, sizeof(reply), "LIST") < 0) { close(sdata); continue; }
+            if (reply[0] != '1') { printf("%s", reply); close(sdata); continue; }
+            if (datos_tls(sdata, s_control) < 0) {
+                close(sdata);
+                expect_reply(s_control, reply, sizeof(reply));
+                continue;
+            }
             /* leer datos y mostrar */
-            while ((n = recv(sdata, data_buf, sizeof(data_buf), 0)) > 0) {
+            while ((n = net_recv(sdata, data_buf, sizeof(data_buf))) > 0) {
                 fwrite(data_buf, 1, n, stdout);
             }
-            close(sdata);
+            if (n < 0) perror("dir: listado incompleto");
+            net_close(sdata);
             if (expect_reply(s_control, reply, sizeof(reply)) >= 0) {
                 printf("%s", reply);
             }
             continue;
         }
 
+        if (strcmp(ucmd, "fanput") == 0) {
+            char *destinos[FAN_MAX];
+            int ndest = 0, corte = 0;
+            if (arg && strcmp(arg, "-t") == 0) {
+                char *t = strtok(NULL, " ");
+                corte = t ? atoi(t) : 0;
+                arg = strtok(NULL, " ");
+            }
+            char *d;
+            int sobran = 0;
+            while ((d = strtok(NULL, " ")) != NULL) {
+                if (ndest < FAN_MAX) destinos[ndest++] = d;
+                else sobran++;
+            }
+            if (!arg || ndest == 0) {
+                printf("Uso: fanput [-t seg] <archivo> host[:puerto] ...\n");
+                continue;
+            }
+            if (sobran) {
+                printf("fanput: como máximo %d destinos (%d de más), no se sube nada\n",
+                       FAN_MAX, sobran);
+                continue;
+            }
+            subir_abanico(arg, destinos, ndest, corte);
+            continue;
+        }
+
+        if (strcmp(ucmd, "tail") == 0) {
+            char *remoto = strtok(NULL, " ");
+            if (!arg || strcmp(arg, "-f") != 0 || !remoto) {
+                printf("Uso: tail -f <remoto> [local]\n");
+                continue;
+            }
+            seguir_remoto(s_control, remoto, strtok(NULL, " "));
+            continue;
+        }
+
+        if (strcmp(ucmd, "untail") == 0) {
+            dejar_de_seguir(arg ? (pid_t)atoi(arg) : 0);
+            continue;
+        }
+
+        if (strcmp(ucmd, "cache") == 0) {
+            cache_estadisticas(stdout);
+            continue;
+        }
+
+        if (strcmp(ucmd, "ls") == 0) {
+            int clave = 'n', inverso = 0;
+            char *patron = NULL;
+            for (; arg; arg = strtok(NULL, " ")) {
+                if (strcmp(arg, "-s") == 0) clave = 's';
+                else if (strcmp(arg, "-t") == 0) clave = 't';
+                else if (strcmp(arg, "-r") == 0) inverso = 1;
+                else patron = arg;
+            }
+            listar(s_control, patron, clave, inverso);
+            continue;
+        }
+
         if (strcmp(ucmd, "get") == 0) {
             if (!arg) { printf("Uso: get <archivo>\n"); continue; }
+
+            /* caché: SIZE/MDTM antes del RETR; en acierto no hay transferencia */
+            char clave[2 * LINELEN];
+            long long tam = -1;
+            int cachear = g_cache && !g_ascii &&
+                clave_cache(s_control, arg, clave, sizeof(clave), &tam) == 0;
+            if (cachear && cache_buscar(clave, arg) == 1) {
+                printf("get %s: servido desde la caché local (%lld bytes)\n", arg, tam);
+                continue;
+            }
             
             sdata = pasivo_conn(s_control);
             if (sdata < 0) continue;
@@ -384,21 +1320,35 @@ int main(int argc, char *argv[]) {
             }
             
             if (pid == 0) {
+                if (datos_tls(sdata, s_control) < 0) {
+                    close(sdata);
+                    exit(1);
+                }
                 FILE *fp_child = fopen(arg, "wb");
                 if (!fp_child) { 
                     perror("fopen"); 
-                    close(sdata); 
+                    net_close(sdata); 
                     exit(1); 
                 }
                 
-                while ((n = recv(sdata, data_buf, sizeof(data_buf), 0)) > 0) {
-                    fwrite(data_buf, 1, n, fp_child);
+                long long recibidos = 0;
+                char conv[sizeof(data_buf) + 1];
+                int cr_pend = 0;
+                while ((n = net_recv(sdata, data_buf, sizeof(data_buf))) > 0) {
+                    if (g_ascii)
+                        fwrite(conv, 1, crlf_a_lf(data_buf, n, conv, &cr_pend), fp_child);
+                    else
+                        fwrite(data_buf, 1, n, fp_child);
+                    recibidos += n;
                 }
+                if (g_ascii) fwrite(conv, 1, crlf_fin(conv, &cr_pend), fp_child);
                 
-                fclose(fp_child);
-                close(sdata);
+                if (n < 0) perror("get: transferencia incompleta");
+                int ok = fclose(fp_child) == 0 && n == 0;
+                net_close(sdata);
+                if (cachear && ok && recibidos == tam) cache_guardar(clave, arg);
                 
-                exit(0);
+                exit(ok ? 0 : 1);
             } else {
                 close(sdata);
                 printf("Transferencia GET iniciada (PID %d)\n", pid);
@@ -413,70 +1363,15 @@ int main(int argc, char *argv[]) {
 
         if (strcmp(ucmd, "put") == 0) {
             if (!arg) { printf("Uso: put <archivo>\n"); continue; }
-            
-            fp = fopen(arg, "rb");
-            if (!fp) { perror("Open local file"); continue; }
-            
-            sdata = pasivo_conn(s_control);
-            if (sdata < 0) { fclose(fp); continue; }
-            
-            if (send_cmd(s_control, reply, sizeof(reply), "STOR %s", arg) < 0) { 
-                close(sdata); 
-                fclose(fp); 
-                continue; 
-            }
-            
-            if (reply[0] != '1') { 
-                printf("%s", reply); 
-                close(sdata); 
-                fclose(fp); 
-                continue; 
-            }
-            
-            fclose(fp);
-            
-            pid = fork();
-            if (pid < 0) { 
-                perror("fork"); 
-                close(sdata); 
-                continue; 
-            }
-            
-            if (pid == 0) {
-                FILE *fp_child = fopen(arg, "rb");
-                if (!fp_child) { 
-                    perror("fopen child"); 
-                    close(sdata); 
-                    exit(1); 
-                }
-                
-                while ((n = fread(data_buf, 1, sizeof(data_buf), fp_child)) > 0) {
-                    size_t sent = 0;
-                    while (sent < (size_t)n) {
-                        ssize_t w = send(sdata, data_buf + sent, n - sent, 0);
-                        if (w < 0) {
-                            if (errno == EINTR) continue;
-                            perror("send data");
-                            fclose(fp_child);
-                            close(sdata);
-                            exit(1);
-                        }
-                        sent += w;
-                    }
-                }
-                
-                fclose(fp_child);
-                close(sdata);
-                exit(0);
-            } else {
-                close(sdata);
-                printf("Transferencia PUT iniciada (PID %d)\n", pid);
-                
-                if (expect_reply(s_control, reply, sizeof(reply)) >= 0) {
-                    printf("%s", reply);
-                }
-                continue;
-            }
+            subir(s_control, arg);
+            continue;
+        }
+
+        if (strcmp(ucmd, "putpar") == 0) {
+            if (!arg) { printf("Uso: putpar <archivo> [segmentos]\n"); continue; }
+            char *nstr = strtok(NULL, " ");
+            subir_paralelo(s_control, arg, nstr ? atoi(nstr) : SEG_DEF);
+            continue;
         }
 
         if (strcmp(ucmd, "pput") == 0) {
@@ -531,29 +1426,22 @@ int main(int argc, char *argv[]) {
                     exit(1); 
                 }
                 
-                FILE *fp_child = fopen(arg, "rb");
-                if (!fp_child) { 
-                    perror("fopen child"); 
-                    close(sdata_child); 
+                if (datos_tls(sdata_child, s_control) < 0) {
+                    close(sdata_child);
+                    exit(1);
+                }
+                int fd_child = open(arg, O_RDONLY);
+                if (fd_child < 0) { 
+                    perror("open child"); 
+                    net_close(sdata_child); 
                     exit(1); 
                 }
                 
-                while ((n = fread(data_buf, 1, sizeof(data_buf), fp_child)) > 0) {
-                    size_t sent = 0;
-                    while (sent < (size_t)n) {
-                        ssize_t w = send(sdata_child, data_buf + sent, n - sent, 0);
-                        if (w < 0) {
-                            if (errno == EINTR) continue;
-                            perror("send");
-                            break;
-                        }
-                        sent += w;
-                    }
-                }
+                int rc = enviar_archivo(sdata_child, fd_child, 0, -1);
                 
-                fclose(fp_child);
-                close(sdata_child);
-                exit(0);
+                close(fd_child);
+                net_close(sdata_child);
+                exit(rc < 0 ? 1 : 0);
             } else {
                 close(s_listen);
                 printf("Transferencia PPUT iniciada (PID %d)\n", pid);
@@ -564,6 +1452,13 @@ int main(int argc, char *argv[]) {
                 continue;
             }
         }
+        if (strcmp(ucmd, "ascii") == 0 || strcmp(ucmd, "binary") == 0) {
+            int a = ucmd[0] == 'a';
+            int code = send_cmd(s_control, reply, sizeof(reply), a ? "TYPE A" : "TYPE I");
+            if (code >= 0) printf("%s", reply);
+            if (code / 100 == 2) g_ascii = a;
+            continue;
+        }
        /* CWD, PWD, MKD, DELE (no concurrentes en general) */
         if (strcmp(ucmd, "cd") == 0) {
             if (!arg) { printf("Uso: cd <dir>\n"); continue; }
@@ -589,6 +1484,7 @@ int main(int argc, char *argv[]) {
         printf("%s: comando no implementado. Escriba 'help' para ver los comandos disponibles.\n", ucmd);
     }
 
-    close(s_control);
+    dejar_de_seguir(0);
+    net_close(s_control);
     return 0;
 }
\ No newline at end of file
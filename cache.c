@@ -0,0 +1,313 @@
+/* cache.c - cache_abrir, cache_buscar, cache_guardar, cache_estadisticas */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <linux/fs.h>		/* FICLONE					*/
+#endif
+
+#define	NOMBRE_LEN	16	/* clave: FNV-1a de 64 bits en hexadecimal	*/
+
+static char		cache_dir[256];
+static long long	cache_limite;	/* bytes; 0 = caché desactivada		*/
+
+struct fichero {
+	char		nombre[NOMBRE_LEN + 1];
+	long long	tam;
+	long long	uso;		/* mtime (ns) = último acierto o inserción*/
+};
+
+/* ruta: compone <cache_dir>/<nombre> */
+static void
+ruta(char *buf, size_t n, const char *nombre)
+{
+	snprintf(buf, n, "%s/%s", cache_dir, nombre);
+}
+
+/* hash_clave: FNV-1a de 64 bits de la clave, como nombre de fichero */
+static void
+hash_clave(const char *clave, char nombre[NOMBRE_LEN + 1])
+{
+	unsigned long long h = 1469598103934665603ULL;
+	const unsigned char *p;
+
+	for (p = (const unsigned char *)clave; *p; p++) {
+		h ^= *p;
+		h *= 1099511628211ULL;
+	}
+	snprintf(nombre, NOMBRE_LEN + 1, "%016llx", h);
+}
+
+/* copiar: reflink si el sistema de ficheros lo permite; si no, copy_file_range
+ * y, como último recurso, read/write */
+static int
+copiar(int de, int a)
+{
+	char	buf[65536];
+	ssize_t	r;
+
+#ifdef FICLONE
+	if (ioctl(a, FICLONE, de) == 0)
+		return 0;
+#endif
+	while ((r = copy_file_range(de, NULL, a, NULL, 1 << 30, 0)) > 0)
+		;
+	if (r == 0)
+		return 0;
+	if (errno != EXDEV && errno != ENOSYS && errno != EINVAL &&
+	    errno != EOPNOTSUPP)
+		return -1;
+	if (lseek(de, 0, SEEK_SET) < 0 || ftruncate(a, 0) < 0 ||
+	    lseek(a, 0, SEEK_SET) < 0)
+		return -1;
+	while ((r = read(de, buf, sizeof(buf))) > 0) {
+		ssize_t w = 0;
+		while (w < r) {
+			ssize_t k = write(a, buf + w, r - w);
+			if (k < 0) {
+				if (errno == EINTR)
+					continue;
+				return -1;
+			}
+			w += k;
+		}
+	}
+	return r < 0 ? -1 : 0;
+}
+
+/* contar: suma un acierto o un fallo en el fichero de estadísticas (con flock,
+ * varias sesiones pueden compartir la caché) */
+static void
+contar(int acierto)
+{
+	char	path[512], buf[64];
+	long long ac = 0, fa = 0;
+	ssize_t	n;
+	int	fd;
+
+	ruta(path, sizeof(path), "estadisticas");
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		return;
+	flock(fd, LOCK_EX);
+	if ((n = pread(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[n] = '\0';
+		sscanf(buf, "%lld %lld", &ac, &fa);
+	}
+	if (acierto)
+		ac++;
+	else
+		fa++;
+	n = snprintf(buf, sizeof(buf), "%lld %lld\n", ac, fa);
+	if (ftruncate(fd, 0) == 0)
+		(void)!pwrite(fd, buf, n, 0);
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+static int
+por_uso(const void *a, const void *b)
+{
+	const struct fichero *x = a, *y = b;
+
+	return (x->uso > y->uso) - (x->uso < y->uso);
+}
+
+/* recorrer: lista las entradas de la caché; devuelve cuántas y el total en bytes */
+static size_t
+recorrer(struct fichero **lista, long long *total)
+{
+	struct fichero *v = NULL;
+	size_t	n = 0, cap = 0;
+	struct dirent *de;
+	struct stat st;
+	char	path[512];
+	DIR	*d;
+
+	*total = 0;
+	if ((d = opendir(cache_dir)) == NULL) {
+		*lista = NULL;
+		return 0;
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (strlen(de->d_name) != NOMBRE_LEN ||
+		    strspn(de->d_name, "0123456789abcdef") != NOMBRE_LEN)
+			continue;
+		ruta(path, sizeof(path), de->d_name);
+		if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+			continue;
+		if (n == cap) {
+			struct fichero *nv;
+			cap = cap ? cap * 2 : 64;
+			if ((nv = realloc(v, cap * sizeof(*v))) == NULL)
+				break;
+			v = nv;
+		}
+		memcpy(v[n].nombre, de->d_name, NOMBRE_LEN + 1);
+		v[n].tam = (long long)st.st_size;
+		v[n].uso = (long long)st.st_mtim.tv_sec * 1000000000 +
+		    st.st_mtim.tv_nsec;
+		*total += v[n].tam;
+		n++;
+	}
+	closedir(d);
+	*lista = v;
+	return n;
+}
+
+/* desalojar: borra las entradas usadas hace más tiempo hasta quedar bajo el límite */
+static void
+desalojar(void)
+{
+	struct fichero *v;
+	long long total;
+	char	path[512];
+	size_t	n, i;
+
+	n = recorrer(&v, &total);
+	if (total > cache_limite) {
+		qsort(v, n, sizeof(*v), por_uso);
+		for (i = 0; i < n && total > cache_limite; i++) {
+			ruta(path, sizeof(path), v[i].nombre);
+			if (unlink(path) == 0)
+				total -= v[i].tam;
+		}
+	}
+	free(v);
+}
+
+/*------------------------------------------------------------------------
+ * cache_abrir - enable the download cache in a directory
+ *------------------------------------------------------------------------
+ */
+int
+cache_abrir(const char *dir, long long limite)
+/*
+ * Arguments:
+ *      dir    - cache directory (created if missing)
+ *      limite - maximum total size of cached files, in bytes
+ */
+{
+	if (mkdir(dir, 0755) < 0 && errno != EEXIST)
+		return -1;
+	if (strlen(dir) >= sizeof(cache_dir)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(cache_dir, dir);
+	cache_limite = limite;
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * cache_buscar - satisfy a download from the cache if the key is present
+ *------------------------------------------------------------------------
+ */
+int
+cache_buscar(const char *clave, const char *destino)
+/*
+ * Arguments:
+ *      clave   - host, remote path, SIZE and MDTM of the remote file
+ *      destino - local file to create
+ *
+ * Returns 1 on a hit (destino written), 0 on a miss, -1 on error.
+ */
+{
+	char	nombre[NOMBRE_LEN + 1], path[512];
+	int	de, a, r;
+
+	if (cache_limite <= 0)
+		return 0;
+	hash_clave(clave, nombre);
+	ruta(path, sizeof(path), nombre);
+	if ((de = open(path, O_RDONLY)) < 0) {
+		contar(0);
+		return 0;
+	}
+	if ((a = open(destino, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		close(de);
+		return -1;
+	}
+	r = copiar(de, a);
+	close(de);
+	if (close(a) < 0 || r < 0) {
+		unlink(destino);
+		return -1;
+	}
+	utimensat(AT_FDCWD, path, NULL, 0);	/* LRU: marcar como recién usado */
+	contar(1);
+	return 1;
+}
+
+/*------------------------------------------------------------------------
+ * cache_guardar - add a freshly downloaded file and evict old entries
+ *------------------------------------------------------------------------
+ */
+int
+cache_guardar(const char *clave, const char *origen)
+{
+	char	nombre[NOMBRE_LEN + 1], path[512], tmp[512];
+	int	de, a, r;
+
+	if (cache_limite <= 0)
+		return 0;
+	hash_clave(clave, nombre);
+	ruta(path, sizeof(path), nombre);
+	snprintf(tmp, sizeof(tmp), "%s/.tmp.%ld", cache_dir, (long)getpid());
+	if ((de = open(origen, O_RDONLY)) < 0)
+		return -1;
+	if ((a = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		close(de);
+		return -1;
+	}
+	r = copiar(de, a);
+	close(de);
+	if (close(a) < 0 || r < 0 || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return -1;
+	}
+	desalojar();
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * cache_estadisticas - print hit ratio and current size of the cache
+ *------------------------------------------------------------------------
+ */
+void
+cache_estadisticas(FILE *out)
+{
+	struct fichero *v;
+	long long total, ac = 0, fa = 0;
+	char	path[512];
+	size_t	n;
+	FILE	*f;
+
+	if (cache_limite <= 0) {
+		fprintf(out, "Caché desactivada (use -C <dir>)\n");
+		return;
+	}
+	ruta(path, sizeof(path), "estadisticas");
+	if ((f = fopen(path, "r")) != NULL) {
+		if (fscanf(f, "%lld %lld", &ac, &fa) != 2)
+			ac = fa = 0;
+		fclose(f);
+	}
+	n = recorrer(&v, &total);
+	free(v);
+	fprintf(out, "Caché %s: %zu archivos, %lld de %lld bytes\n",
+	    cache_dir, n, total, cache_limite);
+	fprintf(out, "Aciertos %lld, fallos %lld, tasa de acierto %.1f%%\n",
+	    ac, fa, ac + fa ? 100.0 * ac / (ac + fa) : 0.0);
+}
@@ -0,0 +1,160 @@
+/* crlf.c - crlf_a_lf, crlf_fin, lf_a_crlf */
+
+#include <sys/types.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Traducción de fin de línea para TYPE A (RFC 959): la red usa CRLF y el
+ * archivo local LF. Ambos núcleos recorren bloques de 16 bytes con SSE2; un
+ * bloque sin el carácter buscado se copia entero y solo los bloques que lo
+ * contienen se tratan byte a byte, de modo que un texto con líneas normales
+ * se copia casi a la velocidad de memcpy. El estado entre trozos permite que
+ * un par CR/LF quede partido entre dos recv() o dos read().
+ */
+
+#ifdef __SSE2__
+/* mascara: bit i activo si p[i] == c, para los 16 bytes de p */
+static unsigned
+mascara(const char *p, __m128i c)
+{
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+	    _mm_loadu_si128((const __m128i *)p), c));
+}
+#endif
+
+/*------------------------------------------------------------------------
+ * crlf_a_lf - network to local: drop the CR of every CRLF pair
+ *------------------------------------------------------------------------
+ */
+size_t
+crlf_a_lf(const char *in, size_t n, char *out, int *cr_pend)
+/*
+ * Arguments:
+ *      in      - bytes received from the data connection
+ *      n       - number of bytes in in
+ *      out     - destination, room for n + 1 bytes
+ *      cr_pend - state: previous chunk ended in a CR not yet written
+ *
+ * Returns the number of bytes written to out.
+ */
+{
+	const char *p = in, *fin = in + n, *ini;
+	char	*o = out;
+
+	if (n == 0)
+		return 0;
+	if (*cr_pend) {
+		if (*p != '\n')
+			*o++ = '\r';	/* CR suelto: se conserva */
+		*cr_pend = 0;
+	}
+	ini = p;
+#ifdef __SSE2__
+	{
+		const __m128i cr = _mm_set1_epi8('\r');
+		while (fin - p >= 16) {
+			unsigned m = mascara(p, cr);
+			while (m) {
+				const char *c = p + __builtin_ctz(m);
+				m &= m - 1;
+				if (c + 1 == fin)
+					break;	/* último byte: lo decide el trozo siguiente */
+				if (c[1] == '\n') {
+					memcpy(o, ini, c - ini);
+					o += c - ini;
+					ini = c + 1;
+				}
+			}
+			p += 16;
+		}
+	}
+#endif
+	for (; p < fin; p++) {
+		if (*p == '\r' && p + 1 < fin && p[1] == '\n') {
+			memcpy(o, ini, p - ini);
+			o += p - ini;
+			ini = p + 1;
+		}
+	}
+	if (fin[-1] == '\r' && ini < fin) {
+		fin--;			/* retener el CR final */
+		*cr_pend = 1;
+	}
+	memcpy(o, ini, fin - ini);
+	o += fin - ini;
+	return (size_t)(o - out);
+}
+
+/*------------------------------------------------------------------------
+ * crlf_fin - flush a CR held back at the end of the transfer
+ *------------------------------------------------------------------------
+ */
+size_t
+crlf_fin(char *out, int *cr_pend)
+{
+	if (!*cr_pend)
+		return 0;
+	*cr_pend = 0;
+	out[0] = '\r';
+	return 1;
+}
+
+/*------------------------------------------------------------------------
+ * lf_a_crlf - local to network: turn every bare LF into CRLF
+ *------------------------------------------------------------------------
+ */
+size_t
+lf_a_crlf(const char *in, size_t n, char *out, int *ult_cr)
+/*
+ * Arguments:
+ *      in     - bytes read from the local file
+ *      n      - number of bytes in in
+ *      out    - destination, room for 2 * n bytes
+ *      ult_cr - state: last byte of the previous chunk was a CR
+ *
+ * A LF already preceded by CR (also across chunks) is left alone, so a file
+ * that already has CRLF line endings is sent unchanged.
+ */
+{
+	const char *p = in, *fin = in + n, *ini = in;
+	char	*o = out;
+	int	prev = *ult_cr;
+
+	if (n == 0)
+		return 0;
+#ifdef __SSE2__
+	{
+		const __m128i lf = _mm_set1_epi8('\n');
+		while (fin - p >= 16) {
+			unsigned m = mascara(p, lf);
+			while (m) {
+				const char *c = p + __builtin_ctz(m);
+				m &= m - 1;
+				if (c == in ? prev : c[-1] == '\r')
+					continue;
+				memcpy(o, ini, c - ini);
+				o += c - ini;
+				*o++ = '\r';
+				ini = c;
+			}
+			p += 16;
+		}
+	}
+#endif
+	for (; p < fin; p++) {
+		if (*p == '\n' && !(p == in ? prev : p[-1] == '\r')) {
+			memcpy(o, ini, p - ini);
+			o += p - ini;
+			*o++ = '\r';
+			ini = p;
+		}
+	}
+	memcpy(o, ini, fin - ini);
+	o += fin - ini;
+	*ult_cr = fin[-1] == '\r';
+	return (size_t)(o - out);
+}
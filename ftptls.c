@@ -0,0 +1,272 @@
+/* ftptls.c - tls_init, tls_start, net_recv, net_send, net_sendfile, net_close */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#define	TLS_MAXFD	1024	/* descriptores con estado TLS		*/
+
+static SSL_CTX	*ctx;			/* contexto cliente compartido	*/
+static SSL	*ssl_tab[TLS_MAXFD];	/* sesion TLS asociada a cada fd	*/
+static int	verify_peer;		/* verificar certificado del servidor*/
+
+static SSL *
+tls_of(int fd)
+{
+	if (fd < 0 || fd >= TLS_MAXFD)
+		return NULL;
+	return ssl_tab[fd];
+}
+
+/*------------------------------------------------------------------------
+ * tls_init - create the client TLS context used by every connection
+ *------------------------------------------------------------------------
+ */
+int
+tls_init(const char *cafile, int verify)
+/*
+ * Arguments:
+ *      cafile  - PEM file with trusted CAs (NULL = system store)
+ *      verify  - nonzero to verify the server certificate and name
+ */
+{
+	ctx = SSL_CTX_new(TLS_client_method());
+	if (ctx == NULL) {
+		ERR_print_errors_fp(stderr);
+		return -1;
+	}
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+	/* sin SSL_OP_IGNORE_UNEXPECTED_EOF: en PROT P el fin del archivo es el
+	 * close_notify del servidor, y un EOF TCP sin él (transferencia cortada)
+	 * debe verse como error (EPROTO), no como un archivo completo */
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+	verify_peer = verify;
+	if (verify) {
+		int ok = cafile ? SSL_CTX_load_verify_locations(ctx, cafile, NULL)
+				: SSL_CTX_set_default_verify_paths(ctx);
+		if (!ok) {
+			ERR_print_errors_fp(stderr);
+			SSL_CTX_free(ctx);
+			ctx = NULL;
+			return -1;
+		}
+		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+	} else
+		SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * tls_start - run the TLS handshake on a connected socket
+ *------------------------------------------------------------------------
+ */
+int
+tls_start(int fd, const char *host, int ctrl_fd)
+/*
+ * Arguments:
+ *      fd      - connected socket (control or data)
+ *      host    - server name used for SNI and certificate checks
+ *      ctrl_fd - control socket whose session is resumed, or -1
+ */
+{
+	struct in6_addr	addr;	/* para distinguir IP literal de nombre	*/
+	SSL	*ssl, *ctrl;
+	int	isip;
+
+	if (ctx == NULL || fd < 0 || fd >= TLS_MAXFD)
+		return -1;
+	ssl = SSL_new(ctx);
+	if (ssl == NULL || !SSL_set_fd(ssl, fd)) {
+		ERR_print_errors_fp(stderr);
+		SSL_free(ssl);
+		return -1;
+	}
+
+	isip = inet_pton(AF_INET, host, &addr) == 1 ||
+		inet_pton(AF_INET6, host, &addr) == 1;
+	if (!isip)
+		SSL_set_tlsext_host_name(ssl, host);
+	if (verify_peer) {
+		if (isip)
+			X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host);
+		else
+			SSL_set1_host(ssl, host);
+	}
+
+	/* reanudar la sesion del canal de control: evita un handshake
+	 * completo por conexion PASV y lo exigen servidores como vsftpd */
+	if ((ctrl = tls_of(ctrl_fd)) != NULL) {
+		SSL_SESSION *sess = SSL_get1_session(ctrl);
+		if (sess) {
+			SSL_set_session(ssl, sess);
+			SSL_SESSION_free(sess);
+		}
+	}
+
+	while (SSL_connect(ssl) <= 0) {
+		if (errno == EINTR && SSL_get_error(ssl, -1) == SSL_ERROR_SYSCALL)
+			continue;
+		fprintf(stderr, "TLS: handshake fallido con %s\n", host);
+		ERR_print_errors_fp(stderr);
+		SSL_free(ssl);
+		return -1;
+	}
+	ssl_tab[fd] = ssl;
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * tls_active - tell whether a socket is protected by TLS
+ *------------------------------------------------------------------------
+ */
+int
+tls_active(int fd)
+{
+	return tls_of(fd) != NULL;
+}
+
+/*------------------------------------------------------------------------
+ * tls_reused - tell whether the handshake on fd resumed a session
+ *------------------------------------------------------------------------
+ */
+int
+tls_reused(int fd)
+{
+	SSL	*ssl = tls_of(fd);
+
+	return ssl != NULL && SSL_session_reused(ssl);
+}
+
+/* tls_errno: traduce el error de SSL_read/SSL_write al estilo recv/send */
+static ssize_t
+tls_errno(SSL *ssl, int r)
+{
+	switch (SSL_get_error(ssl, r)) {
+	case SSL_ERROR_ZERO_RETURN:
+		return 0;
+	case SSL_ERROR_WANT_READ:
+	case SSL_ERROR_WANT_WRITE:
+		errno = EAGAIN;
+		return -1;
+	case SSL_ERROR_SYSCALL:
+		if (errno == 0)
+			errno = EIO;
+		return -1;
+	default:
+		ERR_print_errors_fp(stderr);
+		errno = EPROTO;
+		return -1;
+	}
+}
+
+/*------------------------------------------------------------------------
+ * net_recv - recv() over a plain or TLS-protected socket
+ *------------------------------------------------------------------------
+ */
+ssize_t
+net_recv(int fd, void *buf, size_t len)
+{
+	SSL	*ssl = tls_of(fd);
+	int	r;
+
+	if (ssl == NULL)
+		return recv(fd, buf, len, 0);
+	errno = 0;
+	r = SSL_read(ssl, buf, len > 0x7fffffff ? 0x7fffffff : (int)len);
+	return r > 0 ? r : tls_errno(ssl, r);
+}
+
+/*------------------------------------------------------------------------
+ * net_send - send() over a plain or TLS-protected socket
+ *------------------------------------------------------------------------
+ */
+ssize_t
+net_send(int fd, const void *buf, size_t len)
+{
+	SSL	*ssl = tls_of(fd);
+	int	r;
+
+	if (ssl == NULL)
+		return send(fd, buf, len, MSG_NOSIGNAL);
+	errno = 0;
+	r = SSL_write(ssl, buf, len > 0x7fffffff ? 0x7fffffff : (int)len);
+	return r > 0 ? r : tls_errno(ssl, r);
+}
+
+/*------------------------------------------------------------------------
+ * net_sendfile - zero-copy file to socket copy, also under kTLS
+ *------------------------------------------------------------------------
+ */
+ssize_t
+net_sendfile(int fd, int in_fd, off_t *offset, size_t count)
+/*
+ * Arguments:
+ *      fd      - destination socket
+ *      in_fd   - source file
+ *      offset  - file offset, advanced by the bytes sent
+ *      count   - maximum number of bytes to send
+ *
+ * Returns -1 with errno = ENOTSUP when the socket is TLS-protected
+ * without kernel offload; the caller then falls back to read/send.
+ */
+{
+	SSL	*ssl = tls_of(fd);
+
+	if (ssl == NULL)
+		return sendfile(fd, in_fd, offset, count);
+#if !defined(OPENSSL_NO_KTLS) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if (BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+		ossl_ssize_t r = SSL_sendfile(ssl, in_fd, *offset, count, 0);
+		if (r > 0)
+			*offset += r;
+		return r;
+	}
+#endif
+	errno = ENOTSUP;
+	return -1;
+}
+
+/*------------------------------------------------------------------------
+ * net_close - send close_notify if needed, then close the socket
+ *------------------------------------------------------------------------
+ */
+int
+net_close(int fd)
+{
+	SSL	*ssl = tls_of(fd);
+	char	buf[256];
+
+	if (ssl != NULL) {
+		/* esperar el close_notify del servidor: cerrar con datos TLS sin
+		 * leer (tickets de sesion) provoca un RST que descarta lo que el
+		 * servidor aun no ha leido del canal de datos */
+		if (SSL_shutdown(ssl) == 0) {
+			struct timeval tv = { 10, 0 };
+			shutdown(fd, SHUT_WR);
+			setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+			while (SSL_read(ssl, buf, sizeof(buf)) > 0)
+				;
+		}
+		SSL_free(ssl);
+		ssl_tab[fd] = NULL;
+	}
+	return close(fd);
+}
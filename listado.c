@@ -0,0 +1,550 @@
+/* listado.c - listado_nuevo, listado_alimentar, listado_fin, listado_ordenar,
+ *             listado_imprimir, listado_liberar */
+
+#define _POSIX_C_SOURCE 200809L
+#include <sys/types.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <fnmatch.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define	BLOQUE_MIN	(64 * 1024)	/* tamaño mínimo de bloque de arena	*/
+
+/* entrada: registro compacto en la arena, el nombre va a continuación */
+struct entrada {
+	long long	tam;		/* bytes (-1 si se desconoce)		*/
+	long long	mtime;		/* segundos desde epoch, UTC		*/
+	unsigned int	nlen;		/* longitud del nombre			*/
+	char		tipo;		/* 'f', 'd', 'l' o '?'			*/
+	char		nombre[];	/* terminado en '\0'			*/
+};
+
+struct bloque {
+	struct bloque	*sig;
+	size_t		usado, cap;
+	char		datos[];
+};
+
+struct listado {
+	struct bloque	*bloques;	/* arena: entradas + nombres		*/
+	struct entrada	**idx;		/* un puntero por entrada (ordenar)	*/
+	size_t		n, cap;
+	char		*resto;		/* línea partida entre dos trozos	*/
+	size_t		nresto, cresto;
+	size_t		ignoradas;	/* líneas que no se pudieron parsear	*/
+	time_t		ahora;		/* para inferir el año en LIST Unix	*/
+};
+
+/*------------------------------------------------------------------------
+ * listado_nuevo - create an empty listing
+ *------------------------------------------------------------------------
+ */
+struct listado *
+listado_nuevo(void)
+{
+	struct listado *l = calloc(1, sizeof(*l));
+
+	if (l)
+		l->ahora = time(NULL);
+	return l;
+}
+
+/* arena_reservar: hueco alineado a 8 bytes en el bloque actual o en uno nuevo */
+static void *
+arena_reservar(struct listado *l, size_t tam)
+{
+	struct bloque *b = l->bloques;
+	void	*p;
+
+	tam = (tam + 7) & ~(size_t)7;
+	if (b == NULL || b->cap - b->usado < tam) {
+		size_t cap = tam > BLOQUE_MIN ? tam : BLOQUE_MIN;
+		if (b && cap < b->cap * 2 && b->cap < 16 * BLOQUE_MIN)
+			cap = b->cap * 2;
+		b = malloc(sizeof(*b) + cap);
+		if (b == NULL)
+			return NULL;
+		b->sig = l->bloques;
+		b->usado = 0;
+		b->cap = cap;
+		l->bloques = b;
+	}
+	p = b->datos + b->usado;
+	b->usado += tam;
+	return p;
+}
+
+static int
+agregar(struct listado *l, char tipo, long long tam, long long mtime,
+	const char *nombre, size_t nlen)
+{
+	struct entrada *e;
+
+	if (nlen == 0)
+		return 0;
+	if (l->n == l->cap) {
+		size_t cap = l->cap ? l->cap * 2 : 1024;
+		struct entrada **idx = realloc(l->idx, cap * sizeof(*idx));
+		if (idx == NULL)
+			return -1;
+		l->idx = idx;
+		l->cap = cap;
+	}
+	e = arena_reservar(l, sizeof(*e) + nlen + 1);
+	if (e == NULL)
+		return -1;
+	e->tam = tam;
+	e->mtime = mtime;
+	e->nlen = (unsigned int)nlen;
+	e->tipo = tipo;
+	memcpy(e->nombre, nombre, nlen);
+	e->nombre[nlen] = '\0';
+	l->idx[l->n++] = e;
+	return 0;
+}
+
+/* dias_civiles: días desde 1970-01-01 para una fecha del calendario gregoriano */
+static long long
+dias_civiles(int y, int m, int d)
+{
+	y -= m <= 2;
+	long long era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned)(y - era * 400);
+	unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (long long)doe - 719468;
+}
+
+static long long
+segundos(int y, int mo, int d, int h, int mi, int s)
+{
+	return dias_civiles(y, mo, d) * 86400 + h * 3600 + mi * 60 + s;
+}
+
+static int
+numero(const char *p, int n)
+{
+	int v = 0;
+
+	while (n-- > 0) {
+		if (!isdigit((unsigned char)*p))
+			return -1;
+		v = v * 10 + (*p++ - '0');
+	}
+	return v;
+}
+
+/* parse_mlsd: "type=file;size=12;modify=20240101120000; nombre" (RFC 3659) */
+static int
+parse_mlsd(struct listado *l, const char *p, const char *fin)
+{
+	const char *sp = memchr(p, ' ', fin - p);
+	long long tam = -1, mtime = 0;
+	char tipo = '?';
+
+	if (sp == NULL || sp == p || memchr(p, '=', sp - p) == NULL)
+		return 0;
+	while (p < sp) {
+		const char *sc = memchr(p, ';', sp - p);
+		const char *eq;
+		if (sc == NULL)
+			sc = sp;
+		eq = memchr(p, '=', sc - p);
+		if (eq) {
+			size_t kl = eq - p, vl = sc - eq - 1;
+			const char *v = eq + 1;
+			if (kl == 4 && strncasecmp(p, "type", 4) == 0) {
+				if (vl == 4 && strncasecmp(v, "file", 4) == 0)
+					tipo = 'f';
+				else if (vl == 3 && strncasecmp(v, "dir", 3) == 0)
+					tipo = 'd';
+				else if ((vl == 4 && strncasecmp(v, "cdir", 4) == 0) ||
+				    (vl == 4 && strncasecmp(v, "pdir", 4) == 0))
+					return 1;	/* "." y ".." */
+				else if (vl >= 10 && strncasecmp(v, "OS.unix=sl", 10) == 0)
+					tipo = 'l';
+			} else if ((kl == 4 && strncasecmp(p, "size", 4) == 0) ||
+			    (kl == 4 && strncasecmp(p, "sizd", 4) == 0)) {
+				char *e;
+				if (vl > 0 && isdigit((unsigned char)*v)) {
+					tam = strtoll(v, &e, 10);
+					if (e > sc)
+						tam = -1;
+				}
+			} else if (kl == 6 && strncasecmp(p, "modify", 6) == 0 &&
+			    vl >= 14) {
+				int y = numero(v, 4), mo = numero(v + 4, 2),
+				    d = numero(v + 6, 2), h = numero(v + 8, 2),
+				    mi = numero(v + 10, 2), s = numero(v + 12, 2);
+				if (y >= 0 && mo > 0 && d > 0 && h >= 0 && mi >= 0 && s >= 0)
+					mtime = segundos(y, mo, d, h, mi, s);
+			}
+		}
+		p = sc + 1;
+	}
+	return agregar(l, tipo, tam, mtime, sp + 1, fin - sp - 1) < 0 ? -1 : 1;
+}
+
+static const char *meses = "janfebmaraprmayjunjulaugsepoctnovdec";
+
+static int
+mes(const char *p, size_t n)
+{
+	const char *m;
+
+	if (n != 3)
+		return 0;
+	for (m = meses; *m; m += 3)
+		if (strncasecmp(p, m, 3) == 0)
+			return (int)((m - meses) / 3) + 1;
+	return 0;
+}
+
+/* parse_unix: "-rw-r--r-- 1 user group 1024 Nov 20 10:30 nombre" (ls -l) */
+static int
+parse_unix(struct listado *l, const char *p, const char *fin)
+{
+	const char *tok[16];
+	size_t len[16];
+	int	nt = 0, i, mo = 0, d, y, h = 0, mi = 0;
+	const char *q = p, *nombre;
+	char	tipo;
+
+	if (strchr("-dlbcps", *p) == NULL || fin - p < 10)
+		return 0;
+	/* tokens hasta encontrar "Mes día hora|año" precedido del tamaño */
+	while (q < fin && nt < 16) {
+		while (q < fin && *q == ' ')
+			q++;
+		tok[nt] = q;
+		while (q < fin && *q != ' ')
+			q++;
+		len[nt] = q - tok[nt];
+		nt++;
+		if (nt >= 5 && (mo = mes(tok[nt - 3], len[nt - 3])) != 0 &&
+		    isdigit((unsigned char)*tok[nt - 4]) &&
+		    isdigit((unsigned char)*tok[nt - 2]))
+			break;
+		mo = 0;
+	}
+	if (mo == 0 || q >= fin)
+		return 0;
+	i = nt - 1;
+	d = numero(tok[i - 1], (int)len[i - 1]);
+	if (len[i] == 5 && tok[i][2] == ':') {
+		struct tm tm;
+		gmtime_r(&l->ahora, &tm);
+		h = numero(tok[i], 2);
+		mi = numero(tok[i] + 3, 2);
+		y = tm.tm_year + 1900;
+		/* sin año: los últimos 6 meses; una fecha futura es del año anterior */
+		if (segundos(y, mo, d, h, mi, 0) > (long long)l->ahora + 86400)
+			y--;
+	} else
+		y = numero(tok[i], (int)len[i]);
+	if (d <= 0 || y < 0)
+		return 0;
+
+	nombre = q + 1;
+	tipo = *p == '-' ? 'f' : *p == 'd' ? 'd' : *p == 'l' ? 'l' : '?';
+	if (tipo == 'l') {
+		const char *f;
+		for (f = nombre; f + 4 <= fin; f++)
+			if (memcmp(f, " -> ", 4) == 0) {
+				fin = f;
+				break;
+			}
+	}
+	if ((fin - nombre == 1 && nombre[0] == '.') ||
+	    (fin - nombre == 2 && nombre[0] == '.' && nombre[1] == '.'))
+		return 1;
+	return agregar(l, tipo, strtoll(tok[i - 3], NULL, 10),
+	    segundos(y, mo, d, h, mi, 0), nombre, fin - nombre) < 0 ? -1 : 1;
+}
+
+/* parse_dos: "01-15-24  10:30AM  <DIR>  nombre" o "... 1234 nombre" (IIS) */
+static int
+parse_dos(struct listado *l, const char *p, const char *fin)
+{
+	int	mo, d, y, h, mi;
+	long long tam = -1;
+	char	tipo = 'f';
+	const char *q;
+
+	if (fin - p < 17 || p[2] != '-' || p[5] != '-')
+		return 0;
+	mo = numero(p, 2);
+	d = numero(p + 3, 2);
+	/* año de 4 cifras (IIS con FourDigitYears) o de 2 */
+	if ((y = numero(p + 6, 4)) >= 0 && p[10] == ' ')
+		q = p + 10;
+	else {
+		y = numero(p + 6, 2);
+		q = p + 8;
+		if (y >= 0)
+			y += y < 70 ? 2000 : 1900;
+	}
+	if (mo <= 0 || d <= 0 || y < 0)
+		return 0;
+	while (q < fin && *q == ' ')
+		q++;
+	if (fin - q < 5 || q[2] != ':')
+		return 0;
+	h = numero(q, 2);
+	mi = numero(q + 3, 2);
+	q += 5;
+	if (q + 2 <= fin && (q[0] == 'P' || q[0] == 'p') && h < 12)
+		h += 12;
+	else if (q + 2 <= fin && (q[0] == 'A' || q[0] == 'a') && h == 12)
+		h = 0;
+	while (q < fin && *q != ' ')
+		q++;
+	while (q < fin && *q == ' ')
+		q++;
+	if (fin - q >= 5 && memcmp(q, "<DIR>", 5) == 0) {
+		tipo = 'd';
+		q += 5;
+	} else {
+		char *e;
+		/* strtoll salta '\r' y '\n': sin dígito aquí leería la línea siguiente */
+		if (q == fin || !isdigit((unsigned char)*q))
+			return 0;
+		tam = strtoll(q, &e, 10);
+		if (e == q || e > fin)
+			return 0;
+		q = e;
+	}
+	while (q < fin && *q == ' ')
+		q++;
+	return agregar(l, tipo, tam, segundos(y, mo, d, h, mi, 0), q, fin - q)
+	    < 0 ? -1 : 1;
+}
+
+static int
+procesar_linea(struct listado *l, const char *p, const char *fin)
+{
+	int	r;
+
+	if (fin > p && fin[-1] == '\r')
+		fin--;
+	if (fin == p)
+		return 0;
+	if ((r = parse_mlsd(l, p, fin)) == 0 &&
+	    (r = parse_unix(l, p, fin)) == 0 &&
+	    (r = parse_dos(l, p, fin)) == 0) {
+		if (!(fin - p > 6 && strncmp(p, "total ", 6) == 0))
+			l->ignoradas++;
+	}
+	return r < 0 ? -1 : 0;
+}
+
+/* partir: entrega a procesar_linea cada línea completa de [p, fin); devuelve el
+ * inicio de la línea final incompleta. Con SSE2 compara 16 bytes por
+ * instrucción contra '\n' y recorre los bits de la máscara resultante. */
+static const char *
+partir(struct listado *l, const char *p, const char *fin)
+{
+	const char *ini = p;
+
+#ifdef __SSE2__
+	const __m128i nl = _mm_set1_epi8('\n');
+
+	for (; fin - p >= 16; p += 16) {
+		unsigned m = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)p), nl));
+		while (m) {
+			const char *e = p + __builtin_ctz(m);
+			if (procesar_linea(l, ini, e) < 0)
+				return NULL;
+			ini = e + 1;
+			m &= m - 1;
+		}
+	}
+#endif
+	for (; p < fin; p++)
+		if (*p == '\n') {
+			if (procesar_linea(l, ini, p) < 0)
+				return NULL;
+			ini = p + 1;
+		}
+	return ini;
+}
+
+/*------------------------------------------------------------------------
+ * listado_alimentar - parse one chunk of LIST/MLSD output as it arrives
+ *------------------------------------------------------------------------
+ */
+int
+listado_alimentar(struct listado *l, const char *buf, size_t n)
+/*
+ * Arguments:
+ *      l   - listing being built
+ *      buf - raw bytes from the data connection
+ *      n   - number of bytes in buf
+ *
+ * Lines may be split across chunks; only the incomplete tail is copied.
+ */
+{
+	const char *fin = buf + n, *q;
+
+	if (l->nresto > 0) {
+		const char *nl = memchr(buf, '\n', n);
+		size_t	k = nl ? (size_t)(nl - buf) : n;
+		if (l->nresto + k + 1 > l->cresto) {
+			size_t	c = (l->nresto + k + 1) * 2;
+			char	*r = realloc(l->resto, c);
+			if (r == NULL)
+				return -1;
+			l->resto = r;
+			l->cresto = c;
+		}
+		memcpy(l->resto + l->nresto, buf, k);
+		l->nresto += k;
+		if (nl == NULL)
+			return 0;
+		l->resto[l->nresto] = '\0';	/* tope para strtoll */
+		if (procesar_linea(l, l->resto, l->resto + l->nresto) < 0)
+			return -1;
+		l->nresto = 0;
+		buf = nl + 1;
+	}
+	if ((q = partir(l, buf, fin)) == NULL)
+		return -1;
+	if (q < fin) {
+		size_t	k = fin - q;
+		if (k + 1 > l->cresto) {
+			char	*r = realloc(l->resto, k * 2);
+			if (r == NULL)
+				return -1;
+			l->resto = r;
+			l->cresto = k * 2;
+		}
+		memcpy(l->resto, q, k);
+		l->nresto = k;
+	}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * listado_fin - flush a last line without '\n'; returns number of entries
+ *------------------------------------------------------------------------
+ */
+long
+listado_fin(struct listado *l)
+{
+	if (l->nresto > 0) {
+		l->resto[l->nresto] = '\0';
+		if (procesar_linea(l, l->resto, l->resto + l->nresto) < 0)
+			return -1;
+		l->nresto = 0;
+	}
+	free(l->resto);
+	l->resto = NULL;
+	l->cresto = 0;
+	return (long)l->n;
+}
+
+static int	clave_orden;	/* 'n' nombre, 's' tamaño, 't' fecha	*/
+static int	orden_inverso;
+
+static int
+comparar(const void *a, const void *b)
+{
+	const struct entrada *x = *(const struct entrada * const *)a;
+	const struct entrada *y = *(const struct entrada * const *)b;
+	int	r;
+
+	if (clave_orden == 's')
+		r = (x->tam > y->tam) - (x->tam < y->tam);
+	else if (clave_orden == 't')
+		r = (x->mtime > y->mtime) - (x->mtime < y->mtime);
+	else
+		r = 0;
+	if (r == 0)
+		r = strcmp(x->nombre, y->nombre);
+	return orden_inverso ? -r : r;
+}
+
+/*------------------------------------------------------------------------
+ * listado_ordenar - sort entries by name ('n'), size ('s') or mtime ('t')
+ *------------------------------------------------------------------------
+ */
+void
+listado_ordenar(struct listado *l, int clave, int inverso)
+{
+	clave_orden = clave;
+	orden_inverso = inverso;
+	if (l->n > 1)
+		qsort(l->idx, l->n, sizeof(*l->idx), comparar);
+}
+
+/*------------------------------------------------------------------------
+ * listado_imprimir - print entries matching an fnmatch pattern
+ *------------------------------------------------------------------------
+ */
+size_t
+listado_imprimir(struct listado *l, const char *patron, FILE *out)
+/*
+ * Arguments:
+ *      l      - parsed listing
+ *      patron - shell pattern on the name (NULL = all)
+ *      out    - destination stream
+ */
+{
+	long long total = 0;
+	size_t	i, n = 0;
+
+	for (i = 0; i < l->n; i++) {
+		const struct entrada *e = l->idx[i];
+		char	fecha[32] = "-";
+		time_t	t = (time_t)e->mtime;
+		struct tm tm;
+
+		if (patron && fnmatch(patron, e->nombre, 0) != 0)
+			continue;
+		if (e->mtime && gmtime_r(&t, &tm))
+			strftime(fecha, sizeof(fecha), "%Y-%m-%d %H:%M", &tm);
+		if (e->tam >= 0)
+			fprintf(out, "%c %14lld  %-16s  %s\n", e->tipo, e->tam,
+			    fecha, e->nombre);
+		else
+			fprintf(out, "%c %14s  %-16s  %s\n", e->tipo, "-",
+			    fecha, e->nombre);
+		if (e->tam > 0)
+			total += e->tam;
+		n++;
+	}
+	fprintf(out, "%zu de %zu entradas, %lld bytes", n, l->n, total);
+	if (l->ignoradas)
+		fprintf(out, " (%zu líneas no reconocidas)", l->ignoradas);
+	fprintf(out, "\n");
+	return n;
+}
+
+/*------------------------------------------------------------------------
+ * listado_liberar - release the arena and the index
+ *------------------------------------------------------------------------
+ */
+void
+listado_liberar(struct listado *l)
+{
+	struct bloque *b, *sig;
+
+	if (l == NULL)
+		return;
+	for (b = l->bloques; b; b = sig) {
+		sig = b->sig;
+		free(b);
+	}
+	free(l->idx);
+	free(l->resto);
+	free(l);
+}